@@ -15,6 +15,7 @@
  */
 
 import SwiftUI
+import os.signpost
 
 // Add Secure SQLite/GDFileManager
 import BlackBerryDynamics.SecureStore.File
@@ -32,10 +33,23 @@ class DBController: ObservableObject {
     
     private let SQL_ACCESS_DATA = "SELECT * FROM Colours";
     
+    private let SQL_INSERT_DATA = "insert into Colours values (?,?)"
+    
+    private let SQL_UPDATE_DATA = "UPDATE Colours SET Favourite = ? WHERE ColorID = ?"
+    
     private var documentsDirectory = ""
     
     private var sqlite3Database : OpaquePointer? = nil
     
+    //Prepared statements keyed by their SQL text, reused instead of re-preparing on each call
+    private var statementCache = [String : OpaquePointer]()
+    
+    //Serial queue for all database work, so opening and querying the encrypted database never blocks the UI
+    private let dbQueue = DispatchQueue(label: "com.waasample.goodapisample.database")
+    
+    //Signposts for timing database work in Instruments
+    private let signpostLog = OSLog(subsystem: "com.waasample.goodapisample", category: "Database")
+    
     private let tagsArray = [2,4,6,8,10]
     
     private let databaseFilename = "DB.sqlite"
@@ -49,53 +63,126 @@ class DBController: ObservableObject {
         self.isBlackOn = false
         self.isPinkOn = false
         self.isGreenOn = false
-        self.initializeDB()
+        
+        //Open the database in the background, the toggles update once the colours are read
+        dbQueue.async {
+            self.initializeDB()
+        }
     }
     
-    //Load Colours from Database
-    func loadColours() {
+    deinit {
+        for statement in statementCache.values {
+            sqlite3_finalize(statement)
+        }
+        sqlite3_close(sqlite3Database)
+    }
+    
+    //Get a prepared statement from the cache, or prepare and cache it on first use
+    func cachedStatement(sql : String) -> OpaquePointer? {
+        
+        if let statement = statementCache[sql] {
+            //Make the statement ready to run again with fresh bindings
+            sqlite3_reset(statement)
+            sqlite3_clear_bindings(statement)
+            return statement
+        }
         
         var statement: OpaquePointer? = nil
-        //Execute Query
-        if sqlite3_prepare_v2(sqlite3Database, SQL_ACCESS_DATA, -1, &statement, nil) != SQLITE_OK {
+        if sqlite3_prepare_v2(sqlite3Database, sql, -1, &statement, nil) != SQLITE_OK {
             let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
             print(errmsg)
+            return nil
+        }
+        statementCache[sql] = statement
+        return statement
+    }
+    
+    //Load Colours from Database
+    func loadColours() {
+        dbQueue.async {
+            self.readColours()
         }
+    }
+    
+    //Read the colours on the database queue and update the view on the main queue
+    func readColours() {
+        
+        os_signpost(.begin, log: signpostLog, name: "Read Colours")
+        defer { os_signpost(.end, log: signpostLog, name: "Read Colours") }
+        
+        var colours = [(id : Int, isOn : Bool)]()
+        
+        //Execute Query
+        let statement = cachedStatement(sql: SQL_ACCESS_DATA)
+        
         //Get the data
         while sqlite3_step(statement) == SQLITE_ROW {
             let id = sqlite3_column_int64(statement, 0)
             if let name = sqlite3_column_text(statement, 1) {
-                //update view
                 let nameString = String(cString: name)
-                if nameString == "0" {
-                    setColorToggleValue(id: Int(id), isOn: false)
-                } else {
-                    setColorToggleValue(id: Int(id), isOn: true)
-                }
+                colours.append((id: Int(id), isOn: nameString != "0"))
             } else {
                 print("Data not found")
             }
         }
+        
+        //update view
+        DispatchQueue.main.async {
+            for colour in colours {
+                self.setColorToggleValue(id: colour.id, isOn: colour.isOn)
+            }
+        }
     }
     
     //Save colours to Database
     func saveColours() {
         
-        for i in tagsArray {
-            
-            let value = getColorToggleValue(id: i) ? 1 : 0
+        //Take the toggle values on the main queue before writing them on the database queue
+        let values = tagsArray.map { (id: $0, value: getColorToggleValue(id: $0) ? 1 : 0) }
+        
+        dbQueue.async {
+            self.writeColours(values: values)
+        }
+    }
+    
+    //Write the colour values on the database queue
+    func writeColours(values : [(id : Int, value : Int)]) {
+        
+        os_signpost(.begin, log: signpostLog, name: "Write Colours")
+        defer { os_signpost(.end, log: signpostLog, name: "Write Colours") }
+        
+        //Write all rows in one transaction, so the encrypted journal is committed once rather than per row
+        if sqlite3_exec(sqlite3Database, "BEGIN TRANSACTION", nil, nil, nil) != SQLITE_OK {
+            let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
+            print(errmsg)
+            return
+        }
+        
+        var allUpdated = true
+        
+        for (i, value) in values {
             
-            var updateStatement: OpaquePointer? = nil
-            if sqlite3_prepare_v2(sqlite3Database, "UPDATE Colours SET Favourite = \(value) WHERE ColorID = \(i)", -1, &updateStatement, nil) == SQLITE_OK {
+            if let updateStatement = cachedStatement(sql: SQL_UPDATE_DATA) {
+                sqlite3_bind_int(updateStatement, 1, Int32(value))
+                sqlite3_bind_int(updateStatement, 2, Int32(i))
+                
                 if sqlite3_step(updateStatement) == SQLITE_DONE {
                     print("Successfully updated row.")
                 } else {
                     print("Could not update row.")
+                    allUpdated = false
                 }
             } else {
                 print("UPDATE statement could not be prepared")
+                allUpdated = false
             }
-            sqlite3_finalize(updateStatement)
+        }
+        
+        //Keep the previous colours if any row failed
+        let endTransaction = allUpdated ? "COMMIT TRANSACTION" : "ROLLBACK TRANSACTION"
+        if sqlite3_exec(sqlite3Database, endTransaction, nil, nil, nil) != SQLITE_OK {
+            let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
+            print(errmsg)
         }
     }
     
@@ -108,7 +195,7 @@ class DBController: ObservableObject {
         self.isGreenOn = false
     }
     
-    //Initialize the Database
+    //Initialize the Database, called on the database queue
     func initializeDB() {
         
         let fileURL = try! GDFileManager.default.url(for: .documentDirectory, in: .userDomainMask, appropriateFor: nil, create: false)
@@ -118,14 +205,16 @@ class DBController: ObservableObject {
         
         // Open secure SQL databse
         
+        os_signpost(.begin, log: signpostLog, name: "Open Database")
         if sqlite3enc_open(fileURL.path, &sqlite3Database) != SQLITE_OK {
             print("error opening database")
         }
+        os_signpost(.end, log: signpostLog, name: "Open Database")
         
         //  if Database exists load colour values, else create Database
         
         if checkIfDataAvailable() {
-            loadColours()
+            readColours()
         } else {
             populateData()
         }
@@ -139,14 +228,9 @@ class DBController: ObservableObject {
             print(errmsg)
         }
         
-        var statement: OpaquePointer? = nil
-        
         for i in tagsArray {
             
-            if sqlite3_prepare_v2(sqlite3Database, "insert into Colours values (?,?)", -1, &statement, nil) != SQLITE_OK {
-                let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
-                print(errmsg)
-            }
+            let statement = cachedStatement(sql: SQL_INSERT_DATA)
             
             if sqlite3_bind_text(statement, 1, "\(i)", -1, SQLITE_TRANSIENT) != SQLITE_OK {
                 let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
@@ -162,22 +246,12 @@ class DBController: ObservableObject {
                 let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
                 print(errmsg)
             }
-            
-            if sqlite3_finalize(statement) != SQLITE_OK {
-                let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
-                print(errmsg)
-            }
         }
     }
     
     //check if the table is empty or not
     func checkIfDataAvailable() -> Bool {
-        var statement: OpaquePointer? = nil
-        
-        if sqlite3_prepare_v2(sqlite3Database, SQL_ACCESS_DATA, -1, &statement, nil) != SQLITE_OK {
-            let errmsg = String(cString: sqlite3_errmsg(sqlite3Database))
-            print(errmsg)
-        }
+        let statement = cachedStatement(sql: SQL_ACCESS_DATA)
         
         var dataExists = false
         
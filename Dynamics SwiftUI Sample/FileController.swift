@@ -15,6 +15,7 @@
  */
 
 import SwiftUI
+import os.signpost
 //Use GDFileManager file
 import BlackBerryDynamics.SecureStore.File
 
@@ -28,6 +29,12 @@ class FileController: ObservableObject {
     private let folderName = "SecureFolder"
     private let renamedFile = "NewSecureFile.txt"
     
+    //Serial queue for every secure file and folder action, so decryption never runs on the main thread and actions keep their order
+    private let fileQueue = DispatchQueue(label: "com.waasample.goodapisample.file")
+    
+    //Signposts for timing secure file work in Instruments
+    private let signpostLog = OSLog(subsystem: "com.waasample.goodapisample", category: "File")
+    
     init() {
         self.statusUpdateMsg = "Status"
         self.fileInfo = "<Enter Text>"
@@ -37,18 +44,49 @@ class FileController: ObservableObject {
     //Save To File
     func saveToFile() {
         
-        let result = self.writeMyFile()
+        //Take the text on the main queue, then encrypt and write it on the file queue
+        let text = self.fileInfo
         
-        if result {
-            self.statusUpdateMsg = "Saved to file."
-        } else {
-            self.statusUpdateMsg = "Failed to save."
+        performFileOperation {
+            if self.writeMyFile(text: text) {
+                return (nil, "Saved to file.")
+            } else {
+                return (nil, "Failed to save.")
+            }
         }
     }
     
     //Use GDFileManger to read/write data
     func loadFromFile() {
         
+        //Read and decrypt on the file queue, then update the view on the main queue
+        performFileOperation {
+            return self.readMyFile()
+        }
+    }
+    
+    //Run a file operation on the file queue, then publish its text (when not nil) and status on the main queue.
+    //Every file action goes through the one serial queue, so they complete in the order they were tapped
+    func performFileOperation(_ operation : @escaping () -> (text : String?, status : String)) {
+        
+        fileQueue.async {
+            let result = operation()
+            
+            DispatchQueue.main.async {
+                if let text = result.text {
+                    self.fileInfo = text
+                }
+                self.statusUpdateMsg = result.status
+            }
+        }
+    }
+    
+    //Read the saved text file, returning its text (nil when it can't be read) and a status message
+    func readMyFile() -> (text : String?, status : String) {
+        
+        os_signpost(.begin, log: signpostLog, name: "Read File")
+        defer { os_signpost(.end, log: signpostLog, name: "Read File") }
+        
         let filePath = self.documentsFolderPathForNamed(name: textFilename)
         
         //Initialize GDFileManger to read
@@ -59,47 +97,54 @@ class FileController: ObservableObject {
             
             print("DEBUG: File exists.")
             
-            self.fileInfo = String.init(data: fileManager.contents(atPath: filePath)!, encoding: .utf8) ?? ""
-            self.statusUpdateMsg = "Loaded file."
-            
-            // Use GDFileHandle to get data
-            var fileHandle = GDFileHandle.init()
+            // Use GDFileHandle to get data. The file is decrypted once, and the same data is used for the view and the debug output
             do {
-                fileHandle = try GDFileHandle.init(forReadingFrom: URL.init(string: filePath)!)
+                let fileHandle = try GDFileHandle.init(forReadingFrom: URL.init(string: filePath)!)
+                
+                let fileData = fileHandle.readDataToEndOfFile()
+                fileHandle.closeFile()
+                
+                let fileText = String.init(data: fileData, encoding: .utf8) ?? ""
+                print(fileText)
+                
+                // Display absolute file path
+                let encryptedPath = GDFileManager.getAbsoluteEncryptedPath(filePath)
+                print(encryptedPath!)
+                
+                return (fileText, "Loaded file.")
             }
             catch {
                 print(error.localizedDescription)
+                return (nil, error.localizedDescription)
             }
             
-            let resData = fileHandle.availableData
-            
-            let fileText = String.init(data: resData, encoding: .utf8)
-            print(fileText!)
-            
-            // Display absolute file path
-            let encryptedPath = GDFileManager.getAbsoluteEncryptedPath(filePath)
-            print(encryptedPath!)
-            
         } else {
             
             print("DEBUG: Saved text file doesnt' exist.")
-            self.fileInfo = "<Enter Text>"
-            self.statusUpdateMsg = "Saved text file doesnt' exist."
+            return ("<Enter Text>", "Saved text file doesnt' exist.")
         }
     }
     
     //Clear All The TextFields
     func clearText() {
         
-        self.fileInfo = "<Enter Text>"
-        self.statusUpdateMsg = "Text Cleared."
+        //Queued behind any pending load, so text read by an earlier tap can't reappear after clearing
+        performFileOperation {
+            return ("<Enter Text>", "Text Cleared.")
+        }
     }
     
     //Create the folder
     func createFolder() {
+        performFileOperation {
+            return self.createMyFolder()
+        }
+    }
+    
+    func createMyFolder() -> (text : String?, status : String) {
         
         //Get the Folders Path
-        let folderPath = documentsFolderPathForNamed(name: self.folderName)
+        let folderPath = documentsFolderPathForNamed(name: "/\(folderName)")
         
         //Create directory if it doesn't exist already.
         
@@ -108,28 +153,33 @@ class FileController: ObservableObject {
         
         //Check if the Folder Exists
         if fileManager.fileExists(atPath: folderPath) {
-            self.statusUpdateMsg = "Folder Exists"
+            return (nil, "Folder Exists")
             
         } else {
             do {
                 //Create directory
                 try fileManager.createDirectory(atPath: folderPath, withIntermediateDirectories: false, attributes: nil)
-                self.fileInfo = "\(folderName) Folder Created"
-                self.statusUpdateMsg = "Folder Created"
+                return ("\(folderName) Folder Created", "Folder Created")
             }
             catch {
-                self.statusUpdateMsg = error.localizedDescription
+                return (nil, error.localizedDescription)
             }
         }
     }
     
     //Delete the folder
     func deleteFolder() {
+        performFileOperation {
+            return self.deleteMyFolder()
+        }
+    }
+    
+    func deleteMyFolder() -> (text : String?, status : String) {
         
         //Delete the directory.
         
         //Get the Folders Path
-        let folderPath = documentsFolderPathForNamed(name: self.folderName)
+        let folderPath = documentsFolderPathForNamed(name: "/\(folderName)")
         
         //Initialize GDFileManger to read
         let fileManager = GDFileManager.default()
@@ -139,18 +189,24 @@ class FileController: ObservableObject {
             do {
                 //Delete the Folder
                 try fileManager.removeItem(atPath: folderPath)
-                self.statusUpdateMsg = "Folder Deleted"
+                return (nil, "Folder Deleted")
             }
             catch {
-                self.statusUpdateMsg = error.localizedDescription
+                return (nil, error.localizedDescription)
             }
         } else {
-            self.statusUpdateMsg = "No Folder"
+            return (nil, "No Folder")
         }
     }
     
     //Move File To Folder
     func moveFile() {
+        performFileOperation {
+            return self.moveMyFile()
+        }
+    }
+    
+    func moveMyFile() -> (text : String?, status : String) {
         
         //Move the directory and display its path
         
@@ -163,26 +219,39 @@ class FileController: ObservableObject {
         //Initialize GDFileManger to read
         let fileManager = GDFileManager.default()
         
-        //Get the text from the existing file
-        var text = ""
-        if let fileContent = fileManager.contents(atPath: filePath) {
-            text = String.init(data: fileContent, encoding: .utf8) ?? ""
+        //Check if the File Exists, before touching anything at the new path
+        guard fileManager.fileExists(atPath: filePath) else {
+            return (nil, "No file to move")
         }
         
-        //Create file at new path
-        fileManager.createFile(atPath: newFilePath, contents: text.data(using: .utf8), attributes: nil)
-        
-        self.fileInfo = "New File Path: \(newFilePath) \n\nEncrypted File Path: \(GDFileManager.getAbsoluteEncryptedPath(newFilePath)!)"
-        self.statusUpdateMsg = "File Moved To Folder"
-        
+        do {
+            //Replace a file left at the new path by an earlier move
+            if fileManager.fileExists(atPath: newFilePath) {
+                try fileManager.removeItem(atPath: newFilePath)
+            }
+            
+            //Move the file inside the secure container rather than reading and rewriting its contents
+            try fileManager.moveItem(atPath: filePath, toPath: newFilePath)
+            
+            return ("New File Path: \(newFilePath) \n\nEncrypted File Path: \(GDFileManager.getAbsoluteEncryptedPath(newFilePath)!)", "File Moved To Folder")
+        }
+        catch {
+            return (nil, error.localizedDescription)
+        }
     }
     
     func renameFile() {
+        performFileOperation {
+            return self.renameMyFile()
+        }
+    }
+    
+    func renameMyFile() -> (text : String?, status : String) {
         
          //Rename the directory.
         
         //Get the new File's Path
-        let newFilePath = self.documentsFolderPathForNamed(name: "\(folderName)/\(textFilename)")
+        let newFilePath = self.documentsFolderPathForNamed(name: "/\(folderName)/\(textFilename)")
         
         //Get the renamed File's Path
         let renamedFilePath = self.documentsFolderPathForNamed(name: "/\(folderName)/\(renamedFile)")
@@ -191,28 +260,35 @@ class FileController: ObservableObject {
         let fileManager = GDFileManager.default()
         
         //Check if the File Exists
-        if fileManager.fileExists(atPath: newFilePath) {
-            
-            //Create the renamed file with the contents of the existing file
-            fileManager.createFile(atPath: renamedFilePath, contents: fileManager.contents(atPath: newFilePath)!, attributes: nil)
-            
-            do {
-                //Delete the existing file
-                try fileManager.removeItem(atPath: newFilePath)
-                self.fileInfo = "New File Path: \(renamedFilePath) \n Encrypted File Path: \(GDFileManager.getAbsoluteEncryptedPath(renamedFilePath)!)"
-                self.statusUpdateMsg = "File Renamed"
-            }
-            catch {
-                self.statusUpdateMsg = error.localizedDescription
+        guard fileManager.fileExists(atPath: newFilePath) else {
+            return (nil, "No file to rename")
+        }
+        
+        do {
+            //Replace a file left at the renamed path by an earlier rename
+            if fileManager.fileExists(atPath: renamedFilePath) {
+                try fileManager.removeItem(atPath: renamedFilePath)
             }
+            
+            //Rename the existing file in place, without copying its contents
+            try fileManager.moveItem(atPath: newFilePath, toPath: renamedFilePath)
+            return ("New File Path: \(renamedFilePath) \n Encrypted File Path: \(GDFileManager.getAbsoluteEncryptedPath(renamedFilePath)!)", "File Renamed")
+        }
+        catch {
+            return (nil, error.localizedDescription)
         }
     }
     
     //Delete the file
     func deleteFile() {
+        performFileOperation {
+            return self.deleteMyFile()
+        }
+    }
+    
+    func deleteMyFile() -> (text : String?, status : String) {
         
         //Delete the moved file in the new path.
-        self.clearText()
         
         //Get the original File's Path
         let filePath = self.documentsFolderPathForNamed(name: textFilename)
@@ -242,11 +318,11 @@ class FileController: ObservableObject {
                 try fileManager.removeItem(atPath: renamedFilePath)
             }
             
-            self.fileInfo = ""
-            self.statusUpdateMsg = "File Deleted"
+            return ("", "File Deleted")
         }
         catch {
-            self.statusUpdateMsg = error.localizedDescription
+            //The text is cleared even when a delete fails
+            return ("<Enter Text>", error.localizedDescription)
         }
     }
     
@@ -256,14 +332,17 @@ class FileController: ObservableObject {
         return documentsDirectory.appending(name)
     }
     
-    func writeMyFile() -> Bool {
+    func writeMyFile(text : String) -> Bool {
+        
+        os_signpost(.begin, log: signpostLog, name: "Write File")
+        defer { os_signpost(.end, log: signpostLog, name: "Write File") }
         
         // Delete the file if exists
         let filePath = documentsFolderPathForNamed(name: textFilename)
         
         //Initialize GDFileManger to read
         let fileManager = GDFileManager.default()
-        let fileData = self.fileInfo.data(using: .utf8)
+        let fileData = text.data(using: .utf8)
         
         //Create a secure file uisng GDFileManager
         let fileCreated = fileManager.createFile(atPath: filePath, contents: fileData, attributes: nil)
@@ -43,6 +43,9 @@ struct HTTPView: View {
             }.navigationBarTitle("HTTP", displayMode: .inline)
             .padding()
         }
+        .onDisappear {
+            httpVC.invalidateSession()
+        }
     }
 }
 
@@ -15,14 +15,25 @@
  */
 
 import SwiftUI
+import os.signpost
 //Include BlackBerryDynamics Libraries
 import BlackBerryDynamics.AuthenticationToken
 
-class HttpController: NSObject, ObservableObject, URLSessionDelegate {
+class HttpController: NSObject, ObservableObject, URLSessionTaskDelegate {
 
     @Published var urlText : String
     @Published var dataReceived : String
     
+    //Share one session between requests so its connections through the secure channel are kept alive and reused.
+    //The session holds the controller as its delegate until invalidated, so the view ends it with invalidateSession()
+    private var session : URLSession? = nil
+    
+    //URLs with a GET still waiting on a response, so repeated requests for the same URL share one fetch
+    private var inFlightURLs = Set<URL>()
+    
+    //Signposts for timing requests through the secure channel in Instruments
+    private let signpostLog = OSLog(subsystem: "com.waasample.goodapisample", category: "HTTP")
+    
     override init() {
         //Start with public URL
         self.urlText = "http://www.example.com"
@@ -75,13 +86,27 @@ class HttpController: NSObject, ObservableObject, URLSessionDelegate {
         
         // Open the request using NSURLConnection or NSURLSession
         
-        let nsUrl = URL(string: url)
-        let urlRequest = URLRequest(url: nsUrl!)
-        let session = URLSession.init(configuration: URLSessionConfiguration.default, delegate: self, delegateQueue: OperationQueue.init())
+        let nsUrl = URL(string: url)!
+        
+        //The response to the fetch already in flight will update the view
+        if inFlightURLs.contains(nsUrl) {
+            print("Request already in flight for \(url)")
+            return
+        }
+        inFlightURLs.insert(nsUrl)
+        
+        let urlRequest = URLRequest(url: nsUrl)
+        
+        let signpostID = OSSignpostID(log: signpostLog)
+        os_signpost(.begin, log: signpostLog, name: "Request", signpostID: signpostID)
         
-        let task = session.dataTask(with: urlRequest, completionHandler: { (data, response, error) in
+        let task = sharedSession().dataTask(with: urlRequest, completionHandler: { (data, response, error) in
+            
+            os_signpost(.end, log: self.signpostLog, name: "Request", signpostID: signpostID)
             
             DispatchQueue.main.async {
+                self.inFlightURLs.remove(nsUrl)
+                
                 print(response ?? "No Response")
                 print(error?.localizedDescription ?? "No Error")
                 
@@ -95,6 +120,23 @@ class HttpController: NSObject, ObservableObject, URLSessionDelegate {
         task.resume()
     }
     
+    //Return the shared session, creating it for the first request after the view appears
+    func sharedSession() -> URLSession {
+        
+        if let session = session {
+            return session
+        }
+        let newSession = URLSession.init(configuration: URLSessionConfiguration.default, delegate: self, delegateQueue: OperationQueue.init())
+        session = newSession
+        return newSession
+    }
+    
+    //Let requests already started finish, then release the session and its reference to the controller
+    func invalidateSession() {
+        session?.finishTasksAndInvalidate()
+        session = nil
+    }
+    
     func urlSession(_ session: URLSession, didReceive challenge: URLAuthenticationChallenge, completionHandler: @escaping (URLSession.AuthChallengeDisposition, URLCredential?) -> Swift.Void) {
         
         print("connection will send request for authentication challenge")
@@ -113,4 +155,33 @@ class HttpController: NSObject, ObservableObject, URLSessionDelegate {
         }
         
     }
+    
+    // Logs where the time went for each request, to show latency between the device, the Dynamics proxy and the server
+    
+    func urlSession(_ session: URLSession, task: URLSessionTask, didFinishCollecting metrics: URLSessionTaskMetrics) {
+        
+        print("Request metrics for \(task.originalRequest?.url?.absoluteString ?? "unknown URL"), total \(milliseconds(metrics.taskInterval.duration))")
+        
+        // One transaction per attempt, including redirects
+        for transaction in metrics.transactionMetrics {
+            let dns = intervalString(from: transaction.domainLookupStartDate, to: transaction.domainLookupEndDate)
+            let connect = intervalString(from: transaction.connectStartDate, to: transaction.connectEndDate)
+            let tls = intervalString(from: transaction.secureConnectionStartDate, to: transaction.secureConnectionEndDate)
+            let firstByte = intervalString(from: transaction.requestStartDate, to: transaction.responseStartDate)
+            
+            print("  DNS: \(dns), Connect: \(connect), TLS: \(tls), Time to first byte: \(firstByte), Reused connection: \(transaction.isReusedConnection), Bytes received: \(transaction.countOfResponseBodyBytesReceived)")
+        }
+    }
+    
+    func intervalString(from start : Date?, to end : Date?) -> String {
+        
+        guard let start = start, let end = end else {
+            return "n/a"
+        }
+        return milliseconds(end.timeIntervalSince(start))
+    }
+    
+    func milliseconds(_ interval : TimeInterval) -> String {
+        return String(format: "%.1f ms", interval * 1000.0)
+    }
 }
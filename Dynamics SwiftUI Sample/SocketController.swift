@@ -15,18 +15,42 @@
  */
 
 import SwiftUI
+import os.signpost
 import BlackBerryDynamics.SecureCommunication
 
 
+//GDSocket calls its delegate on the run loop of the thread that connected it. connectToServer runs from the
+//view's buttons, so every callback, and every property below, is only used on the main thread without locking
 class SocketController: ObservableObject, GDSocketDelegate {
     
     var gdSocket = GDSocket()
     
+    //Whether gdSocket has been connected, rather than being the unused placeholder above
+    private var hasConnectedSocket = false
+    
     @Published var statusLabel : String
     @Published var ipAddressText : String
     @Published var portText : String
     @Published var dataRecieved: String
     
+    //Signposts for timing the connection and response through the secure channel in Instruments
+    private let signpostLog = OSLog(subsystem: "com.waasample.goodapisample", category: "Socket")
+    private var signpostID = OSSignpostID.invalid
+    
+    //The signpost interval still open for the current socket, ended by whichever callback finishes it
+    private enum SignpostInterval {
+        case connect
+        case response
+    }
+    private var activeInterval : SignpostInterval? = nil
+    
+    //Raw bytes read from the socket since the last connect, decoded when the view is updated
+    private var receivedData = Data()
+    private var isUpdateScheduled = false
+    
+    //Delay before the view shows newly read data, about one display frame
+    private let updateInterval : TimeInterval = 1.0 / 60.0
+    
     init() {
         
         self.statusLabel = "Disconnected"
@@ -47,28 +71,96 @@ class SocketController: ObservableObject, GDSocketDelegate {
         
         let nsstring : NSString = NSString.init(string: self.ipAddressText)
         
+        //Close the previous connection before replacing it
+        disconnectSocket()
+        
         gdSocket = GDSocket(nsstring.utf8String!, onPort: intCast, andUseSSL: false)
         
         gdSocket.delegate = self
         
         self.statusLabel = "Socket connecting."
         
+        resetReceivedData()
+        
+        signpostID = OSSignpostID(log: signpostLog)
+        os_signpost(.begin, log: signpostLog, name: "Connect", signpostID: signpostID)
+        activeInterval = .connect
+        
         gdSocket.connect()
+        hasConnectedSocket = true
         
         self.statusLabel = "Socket connected."
         
     }
     
+    //Close the current connection, if any. disconnect() finishes asynchronously, and the socket's remaining
+    //callbacks are ignored once gdSocket no longer refers to it
+    func disconnectSocket() {
+        if hasConnectedSocket {
+            endActiveInterval()
+            gdSocket.disconnect()
+            gdSocket = GDSocket()
+            hasConnectedSocket = false
+        }
+    }
+    
     func clearText() {
+        //Also close the connection, so a response still being read can't refill the text after clearing
+        disconnectSocket()
+        resetReceivedData()
         self.dataRecieved = ""
         self.statusLabel = "Disconnected"
     }
     
+    func resetReceivedData() {
+        receivedData = Data()
+    }
+    
+    //Add bytes read from the socket, scheduling one view update for all reads in the next frame.
+    //Bytes are kept raw so a UTF-8 character split across reads is decoded whole once its last byte arrives
+    func appendReceivedData(_ data : Data) {
+        
+        receivedData.append(data)
+        
+        if !isUpdateScheduled {
+            isUpdateScheduled = true
+            DispatchQueue.main.asyncAfter(deadline: .now() + updateInterval) {
+                self.isUpdateScheduled = false
+                self.dataRecieved = String(decoding: self.receivedData, as: UTF8.self)
+            }
+        }
+    }
+    
+    //End the open signpost interval, if any. A connection can fail before onOpen, or close without one
+    func endActiveInterval() {
+        switch activeInterval {
+        case .connect?:
+            os_signpost(.end, log: signpostLog, name: "Connect", signpostID: signpostID)
+        case .response?:
+            os_signpost(.end, log: signpostLog, name: "Response", signpostID: signpostID)
+        case nil:
+            break
+        }
+        activeInterval = nil
+    }
+    
+    //Callbacks from a socket that was disconnected or replaced are ignored
+    func isCurrentSocket(_ socket: Any) -> Bool {
+        return (socket as AnyObject) === gdSocket
+    }
+    
     //GDSocket callbacks
     
     func onOpen(_ socket: Any) {
+        
+        guard isCurrentSocket(socket) else { return }
+        
         print("DEBUG: Socket open. Loading stream...")
         
+        endActiveInterval()
+        os_signpost(.begin, log: signpostLog, name: "Response", signpostID: signpostID)
+        activeInterval = .response
+        
          //format HTTP request and open/send data through GDSocket
         
         let httpString = "GET http://\(self.ipAddressText)/ HTTP/1.1\r\nHost:\(self.ipAddressText):\(self.portText)\r\nConnection: close\r\n\r\n" as NSString
@@ -84,29 +176,37 @@ class SocketController: ObservableObject, GDSocketDelegate {
     
     func onRead(_ socket: Any) {
         
+        guard isCurrentSocket(socket) else { return }
+        
         print("DEBUG: Socket reading...")
         
-        //Handle GDSocket data received
+        os_signpost(.event, log: signpostLog, name: "Read", signpostID: signpostID)
         
-        let gSocket = socket as! GDSocket
+        //Handle GDSocket data received. The request asks the server to close the connection, so keep reading until onClose
         
-        let str = gSocket.readStream?.unreadDataAsString()
+        let gSocket = socket as! GDSocket
         
-        DispatchQueue.main.async {
-            self.dataRecieved = str! as String
+        if let data = gSocket.readStream?.unreadData() {
+            appendReceivedData(data as Data)
         }
-        gSocket.disconnect()
-        
     }
     
     func onClose(_ socket: Any) {
-        DispatchQueue.main.async {
-            self.statusLabel = "Socket disconnected"
-        }
+        
+        guard isCurrentSocket(socket) else { return }
+        
+        endActiveInterval()
+        
+        self.statusLabel = "Socket disconnected"
     }
     
     func onErr(_ error: Int32, inSocket socket: Any) {
         
+        guard isCurrentSocket(socket) else { return }
+        
+        os_signpost(.event, log: signpostLog, name: "Socket Error", signpostID: signpostID, "%d", error)
+        endActiveInterval()
+        
         var errorStr = ""
         
         let socketError : GDSocketErrorType = GDSocketErrorType(rawValue: Int(error))!
@@ -125,15 +225,13 @@ class SocketController: ObservableObject, GDSocketDelegate {
             errorStr = " Unhandled GDSocket Error"
             break
         }
-        DispatchQueue.main.async {
-            if (errorStr != "") {
-                self.statusLabel = "Socket error"
-                self.dataRecieved = "\(error) \(errorStr)"
-            }
-            else {
-                self.statusLabel = "Socket error \(error)"
-                self.dataRecieved = "\(error)"
-            }
+        if (errorStr != "") {
+            self.statusLabel = "Socket error"
+            self.dataRecieved = "\(error) \(errorStr)"
+        }
+        else {
+            self.statusLabel = "Socket error \(error)"
+            self.dataRecieved = "\(error)"
         }
     }
     